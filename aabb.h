@@ -0,0 +1,93 @@
+#ifndef RAYTRACER_AABB_H
+#define RAYTRACER_AABB_H
+
+#include "rtweekend.h"
+
+/**
+ * Axis-aligned bounding box, stored as its minimum and maximum corner.
+ */
+class aabb {
+public:
+    aabb() : minimum(inf, inf, inf), maximum(-inf, -inf, -inf) {}
+
+    aabb(const point3 &a, const point3 &b) : minimum(a), maximum(b) {}
+
+    point3 min() const { return minimum; }
+
+    point3 max() const { return maximum; }
+
+    point3 centroid() const { return 0.5 * (minimum + maximum); }
+
+    /**
+     * Slab test against the box.
+     * @param r Ray
+     * @param inv_dir Component-wise reciprocal of the ray direction.
+     * @param t_min Acceptable range min.
+     * @param t_max Acceptable range max.
+     * @return If the ray overlaps the box inside [t_min, t_max].
+     */
+    bool hit(const ray &r, const vec3 &inv_dir, float t_min, float t_max) const {
+        for (int a = 0; a < 3; a++) {
+            auto t0 = (minimum[a] - r.origin()[a]) * inv_dir[a];
+            auto t1 = (maximum[a] - r.origin()[a]) * inv_dir[a];
+            if (inv_dir[a] < 0.0f)
+                std::swap(t0, t1);
+            // Widen the far distance by the rounding error of the computation, otherwise
+            // rays grazing a box face (e.g. aimed at a mesh vertex) miss the box.
+            t1 *= 1 + 2 * gamma3;
+            // NaN from 0 * inf (ray in the slab plane) falls through these comparisons.
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min)
+                return false;
+        }
+        return true;
+    }
+
+    void expand(const point3 &p) {
+        // Plain comparisons instead of fmin/fmax, which do not inline without -ffast-math.
+        for (int a = 0; a < 3; a++) {
+            minimum[a] = p[a] < minimum[a] ? p[a] : minimum[a];
+            maximum[a] = p[a] > maximum[a] ? p[a] : maximum[a];
+        }
+    }
+
+    void expand(const aabb &box) {
+        for (int a = 0; a < 3; a++) {
+            minimum[a] = box.minimum[a] < minimum[a] ? box.minimum[a] : minimum[a];
+            maximum[a] = box.maximum[a] > maximum[a] ? box.maximum[a] : maximum[a];
+        }
+    }
+
+    /**
+     * @return Index of the longest axis: 0 for x, 1 for y, 2 for z.
+     */
+    int longest_axis() const {
+        auto d = maximum - minimum;
+        if (d.x() > d.y() && d.x() > d.z()) return 0;
+        return d.y() > d.z() ? 1 : 2;
+    }
+
+    float surface_area() const {
+        auto d = maximum - minimum;
+        if (d.x() < 0 || d.y() < 0 || d.z() < 0) return 0;
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
+
+public:
+    point3 minimum;
+    point3 maximum;
+
+private:
+    // Bound on the relative error of three rounded float operations.
+    static constexpr float gamma3 = 3 * std::numeric_limits<float>::epsilon() * 0.5f
+                                    / (1 - 3 * std::numeric_limits<float>::epsilon() * 0.5f);
+};
+
+aabb surrounding_box(const aabb &box0, const aabb &box1) {
+    aabb box = box0;
+    box.expand(box1);
+    return box;
+}
+
+#endif //RAYTRACER_AABB_H
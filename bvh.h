@@ -0,0 +1,658 @@
+#ifndef RAYTRACER_BVH_H
+#define RAYTRACER_BVH_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+#include "hittable_list.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <omp.h>
+
+/**
+ * Node of a flattened BVH. The two children of an interior node are stored next
+ * to each other, and always after their parent.
+ */
+struct bvh_flat_node {
+    aabb box;
+    uint32_t offset;    // Leaf: first entry in prim_indices. Interior: index of the left child, right is offset + 1.
+    uint16_t count;     // Number of primitives in a leaf, 0 for interior nodes.
+    uint16_t axis;      // Split axis of interior nodes, used to order traversal.
+
+    bool is_leaf() const { return count > 0; }
+};
+
+enum class bvh_build_mode {
+    sah,    // Binned surface area heuristic, best trees for final renders.
+    lbvh    // Morton code order, much faster to build, for interactive previews.
+};
+
+struct bvh_build_stats {
+    double build_seconds = 0;
+    float sah_cost = 0;     // Expected cost of a ray through the tree, relative to one primitive test.
+    int depth = 0;          // Number of levels, a lone leaf has depth 1.
+    size_t node_count = 0;
+    size_t leaf_count = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &out, const bvh_build_stats &stats) {
+    return out << stats.node_count << " nodes (" << stats.leaf_count << " leaves), depth " << stats.depth
+               << ", SAH cost " << stats.sah_cost << ", built in " << stats.build_seconds << "s";
+}
+
+/**
+ * Bounding volume hierarchy over an indexed set of primitives. It only knows the
+ * primitives by their bounding boxes, the owner provides the actual intersection
+ * in the traverse() callback.
+ *
+ * Building runs on OpenMP tasks: large subtrees are built concurrently, and the
+ * bounds, binning and partition passes of large nodes are split into chunks.
+ */
+class bvh {
+public:
+    bvh() {}
+
+    explicit bvh(const std::vector<aabb> &prim_boxes, bvh_build_mode mode = bvh_build_mode::sah) {
+        build(prim_boxes, mode);
+    }
+
+    /**
+     * Build the tree from scratch, and fill in stats.
+     */
+    void build(const std::vector<aabb> &prim_boxes, bvh_build_mode mode = bvh_build_mode::sah);
+
+    /**
+     * Update the node boxes for moved primitives, keeping the tree topology. Much
+     * cheaper than build(), but the tree degrades if primitives move far.
+     * @param prim_boxes New boxes, in the same order as given to build().
+     */
+    void refit(const std::vector<aabb> &prim_boxes);
+
+    /**
+     * Walk the tree front to back and hand every candidate primitive to hit_prim.
+     * @param hit_prim Callable as bool(uint32_t prim, float &t_max). On a hit it
+     *                 returns true and shrinks t_max to the hit distance.
+     * @return If any primitive was hit.
+     */
+    template<typename F>
+    bool traverse(const ray &r, float t_min, float t_max, F &&hit_prim) const;
+
+    bool bounding_box(aabb &output_box) const {
+        if (nodes.empty()) return false;
+        output_box = nodes[0].box;
+        return true;
+    }
+
+public:
+    std::vector<bvh_flat_node> nodes;
+    std::vector<uint32_t> prim_indices;
+    bvh_build_stats stats;
+
+    static const int max_leaf_size = 4;
+    static const int max_depth = 64;
+
+    // SAH cost model, relative cost of one node visit and one primitive test.
+    static constexpr float traversal_cost = 1.0f;
+    static constexpr float intersection_cost = 1.0f;
+
+private:
+    struct build_state;
+
+    static const int bin_count = 16;
+    static const uint32_t task_threshold = 4096;        // Smaller subtrees are built by a single task.
+    static const uint32_t parallel_threshold = 65536;   // Larger nodes also split their passes into chunks.
+
+    // Primitive box carried along through the SAH partitions, to keep the passes streaming.
+    struct prim_ref {
+        aabb box;
+        uint32_t index;
+    };
+
+    struct range_bounds {
+        aabb box;
+        aabb centroid_box;
+    };
+
+    struct bin_set {
+        aabb box[3][bin_count];
+        uint32_t count[3][bin_count];
+    };
+
+    void build_sah(build_state &state, uint32_t node_index, uint32_t begin, uint32_t end, int depth);
+
+    void build_lbvh(build_state &state, uint32_t node_index, uint32_t begin, uint32_t end, int depth);
+
+    void make_leaf(uint32_t node_index, uint32_t begin, uint32_t end);
+
+    template<typename P>
+    uint32_t partition(build_state &state, uint32_t begin, uint32_t end, int chunks, P &&pred);
+
+    void compute_stats();
+};
+
+struct bvh::build_state {
+    build_state(const std::vector<aabb> &boxes, int threads) : prim_boxes(boxes), thread_count(threads) {}
+
+    const std::vector<aabb> &prim_boxes;
+    std::vector<prim_ref> refs;         // Primitives in the order they end up in prim_indices (sah only).
+    std::vector<prim_ref> scratch;      // Target of the parallel partition (sah only).
+    std::vector<uint32_t> morton;       // Sorted Morton codes, by position in prim_indices (lbvh only).
+    std::atomic<uint32_t> next_node{1};
+    int thread_count;
+
+    /**
+     * @return Index of two fresh sibling nodes.
+     */
+    uint32_t allocate_pair() { return next_node.fetch_add(2); }
+
+    int chunk_count(uint32_t count) const { return count >= parallel_threshold ? thread_count : 1; }
+};
+
+/**
+ * Run fn(chunk, chunk_begin, chunk_end) over [begin, end) cut into chunks, one
+ * OpenMP task per chunk, and wait for all of them.
+ */
+template<typename F>
+void for_chunks(uint32_t begin, uint32_t end, int chunks, F &&fn) {
+    if (chunks <= 1) {
+        fn(0, begin, end);
+        return;
+    }
+    for (int c = 0; c < chunks; c++) {
+        uint32_t chunk_begin = begin + uint64_t(end - begin) * c / chunks;
+        uint32_t chunk_end = begin + uint64_t(end - begin) * (c + 1) / chunks;
+#pragma omp task default(none) shared(fn) firstprivate(c, chunk_begin, chunk_end)
+        fn(c, chunk_begin, chunk_end);
+    }
+#pragma omp taskwait
+}
+
+/**
+ * Spread the lower 10 bits of v so there are two zero bits between each.
+ */
+inline uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+/**
+ * @return 30-bit Morton code of a point in the unit cube, x in the highest bit of each triple.
+ */
+inline uint32_t morton_code(const point3 &p) {
+    auto quantize = [](float f) { return uint32_t(clamp(f * 1024.0f, 0.0f, 1023.0f)); };
+    return expand_bits(quantize(p.x())) * 4 + expand_bits(quantize(p.y())) * 2 + expand_bits(quantize(p.z()));
+}
+
+void bvh::build(const std::vector<aabb> &prim_boxes, bvh_build_mode mode) {
+    auto start_time = std::chrono::steady_clock::now();
+
+    uint32_t n = prim_boxes.size();
+    nodes.clear();
+    prim_indices.resize(n);
+    stats = bvh_build_stats();
+    if (n == 0) return;
+
+    // A binary tree with leaves of at least one primitive never exceeds 2n - 1 nodes.
+    nodes.resize(2 * size_t(n) - 1);
+    build_state state(prim_boxes, omp_get_max_threads());
+    if (mode == bvh_build_mode::sah) {
+        state.refs.resize(n);
+        state.scratch.resize(n);
+#pragma omp parallel for schedule(static) default(none) shared(n, prim_boxes, state)
+        for (uint32_t i = 0; i < n; i++) {
+            state.refs[i] = {prim_boxes[i], i};
+        }
+    } else {
+        state.morton.resize(n);
+        aabb centroid_box;
+        for (uint32_t i = 0; i < n; i++) {
+            centroid_box.expand(prim_boxes[i].centroid());
+        }
+        vec3 extent = centroid_box.max() - centroid_box.min();
+        vec3 scale(extent.x() > 0 ? 1 / extent.x() : 0,
+                   extent.y() > 0 ? 1 / extent.y() : 0,
+                   extent.z() > 0 ? 1 / extent.z() : 0);
+
+        // Sort by code, with the primitive index in the low half of each key.
+        std::vector<uint64_t> keys(n);
+#pragma omp parallel for schedule(static) default(none) shared(n, prim_boxes, keys, centroid_box, scale)
+        for (uint32_t i = 0; i < n; i++) {
+            uint64_t code = morton_code((prim_boxes[i].centroid() - centroid_box.min()) * scale);
+            keys[i] = code << 32 | i;
+        }
+        std::sort(keys.begin(), keys.end());
+        for (uint32_t i = 0; i < n; i++) {
+            state.morton[i] = keys[i] >> 32;
+            prim_indices[i] = uint32_t(keys[i]);
+        }
+    }
+
+#pragma omp parallel default(none) shared(n, state, mode)
+#pragma omp single
+    {
+        if (mode == bvh_build_mode::sah) {
+            build_sah(state, 0, 0, n, 0);
+        } else {
+            build_lbvh(state, 0, 0, n, 0);
+        }
+    }
+
+    nodes.resize(state.next_node);
+    nodes.shrink_to_fit();
+    if (mode == bvh_build_mode::sah) {
+#pragma omp parallel for schedule(static) default(none) shared(n, state)
+        for (uint32_t i = 0; i < n; i++) {
+            prim_indices[i] = state.refs[i].index;
+        }
+    } else {
+        // The topology only came from the codes, the boxes are filled in bottom-up.
+        refit(prim_boxes);
+    }
+
+    stats.build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    compute_stats();
+}
+
+void bvh::make_leaf(uint32_t node_index, uint32_t begin, uint32_t end) {
+    nodes[node_index].offset = begin;
+    nodes[node_index].count = end - begin;
+    nodes[node_index].axis = 0;
+}
+
+/**
+ * @return Smallest k with 2^k >= n.
+ */
+inline int ceil_log2(uint32_t n) {
+    int k = 0;
+    while ((uint64_t(1) << k) < n) k++;
+    return k;
+}
+
+void bvh::build_sah(build_state &state, uint32_t node_index, uint32_t begin, uint32_t end, int depth) {
+    uint32_t count = end - begin;
+    int chunks = state.chunk_count(count);
+
+    // Bounds of the primitives and of their centroids.
+    range_bounds local_bounds;
+    std::vector<range_bounds> chunk_bounds(chunks > 1 ? chunks : 0);
+    range_bounds *bounds = chunks > 1 ? chunk_bounds.data() : &local_bounds;
+    for_chunks(begin, end, chunks, [&](int c, uint32_t chunk_begin, uint32_t chunk_end) {
+        range_bounds b;
+        for (uint32_t i = chunk_begin; i < chunk_end; i++) {
+            b.box.expand(state.refs[i].box);
+            b.centroid_box.expand(state.refs[i].box.centroid());
+        }
+        bounds[c] = b;
+    });
+    for (int c = 1; c < chunks; c++) {
+        bounds[0].box.expand(bounds[c].box);
+        bounds[0].centroid_box.expand(bounds[c].centroid_box);
+    }
+    const aabb box = bounds[0].box;
+    const aabb centroid_box = bounds[0].centroid_box;
+    nodes[node_index].box = box;
+
+    if (count == 1) {
+        make_leaf(node_index, begin, end);
+        return;
+    }
+
+    vec3 extent = centroid_box.max() - centroid_box.min();
+    vec3 bin_scale(extent.x() > 0 ? bin_count / extent.x() : 0,
+                   extent.y() > 0 ? bin_count / extent.y() : 0,
+                   extent.z() > 0 ? bin_count / extent.z() : 0);
+    const point3 centroid_min = centroid_box.min();
+    auto bin_of = [&](const point3 &centroid, int axis) {
+        int b = int((centroid[axis] - centroid_min[axis]) * bin_scale[axis]);
+        return b < bin_count ? b : bin_count - 1;
+    };
+
+    int best_axis = -1, best_bin = 0;
+    float best_cost = inf;
+    uint32_t mid = begin;
+
+    // Deep down the tree, fall back to median splits so the depth stays bounded.
+    if (depth + ceil_log2(count) < max_depth - 1) {
+        bin_set local_bins;
+        std::vector<bin_set> chunk_bins(chunks > 1 ? chunks : 0);
+        bin_set *bins = chunks > 1 ? chunk_bins.data() : &local_bins;
+        for_chunks(begin, end, chunks, [&](int c, uint32_t chunk_begin, uint32_t chunk_end) {
+            bin_set &b = bins[c];
+            for (int axis = 0; axis < 3; axis++) {
+                for (int k = 0; k < bin_count; k++) {
+                    b.box[axis][k] = aabb();
+                    b.count[axis][k] = 0;
+                }
+            }
+            for (uint32_t i = chunk_begin; i < chunk_end; i++) {
+                const aabb &prim_box = state.refs[i].box;
+                const point3 centroid = prim_box.centroid();
+                for (int axis = 0; axis < 3; axis++) {
+                    if (bin_scale[axis] == 0) continue;
+                    int k = bin_of(centroid, axis);
+                    b.box[axis][k].expand(prim_box);
+                    b.count[axis][k]++;
+                }
+            }
+        });
+        for (int c = 1; c < chunks; c++) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (int k = 0; k < bin_count; k++) {
+                    bins[0].box[axis][k].expand(bins[c].box[axis][k]);
+                    bins[0].count[axis][k] += bins[c].count[axis][k];
+                }
+            }
+        }
+
+        // Sweep the split planes between bins from both sides.
+        float inv_area = 1 / box.surface_area();
+        for (int axis = 0; axis < 3; axis++) {
+            if (bin_scale[axis] == 0) continue;
+            float right_area[bin_count];
+            uint32_t right_count[bin_count];
+            aabb right_box;
+            uint32_t right_n = 0;
+            for (int k = bin_count - 1; k > 0; k--) {
+                if (bins[0].count[axis][k] > 0) {
+                    right_box.expand(bins[0].box[axis][k]);
+                    right_n += bins[0].count[axis][k];
+                }
+                right_area[k] = right_box.surface_area();
+                right_count[k] = right_n;
+            }
+            aabb left_box;
+            uint32_t left_n = 0;
+            for (int k = 0; k < bin_count - 1; k++) {
+                if (bins[0].count[axis][k] == 0) continue;
+                left_box.expand(bins[0].box[axis][k]);
+                left_n += bins[0].count[axis][k];
+                if (right_count[k + 1] == 0) continue;
+                float area_cost = left_box.surface_area() * left_n + right_area[k + 1] * right_count[k + 1];
+                float cost = traversal_cost + intersection_cost * inv_area * area_cost;
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = k;
+                }
+            }
+        }
+
+        if (count <= max_leaf_size && intersection_cost * count <= best_cost) {
+            make_leaf(node_index, begin, end);
+            return;
+        }
+        if (best_axis >= 0) {
+            int axis = best_axis, split = best_bin;
+            mid = partition(state, begin, end, chunks, [&](const prim_ref &ref) {
+                return bin_of(ref.box.centroid(), axis) <= split;
+            });
+        }
+    } else if (count <= max_leaf_size) {
+        make_leaf(node_index, begin, end);
+        return;
+    }
+
+    if (best_axis < 0) {
+        // Median split, in index order when all centroids coincide.
+        best_axis = centroid_box.longest_axis();
+        mid = begin + count / 2;
+        int axis = best_axis;
+        if (extent[axis] > 0)
+            std::nth_element(state.refs.begin() + begin, state.refs.begin() + mid, state.refs.begin() + end,
+                             [&](const prim_ref &a, const prim_ref &b) {
+                                 return a.box.centroid()[axis] < b.box.centroid()[axis];
+                             });
+    }
+
+    uint32_t left = state.allocate_pair();
+    nodes[node_index].offset = left;
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = best_axis;
+
+    if (count > task_threshold) {
+#pragma omp task default(none) shared(state) firstprivate(left, begin, mid, depth)
+        build_sah(state, left, begin, mid, depth + 1);
+    } else {
+        build_sah(state, left, begin, mid, depth + 1);
+    }
+    build_sah(state, left + 1, mid, end, depth + 1);
+}
+
+void bvh::build_lbvh(build_state &state, uint32_t node_index, uint32_t begin, uint32_t end, int depth) {
+    uint32_t count = end - begin;
+    if (count <= max_leaf_size) {
+        make_leaf(node_index, begin, end);
+        return;
+    }
+
+    // Split where the highest differing bit of the codes in the range flips.
+    uint32_t mid = begin + count / 2;
+    int axis = 0;
+    uint32_t diff = state.morton[begin] ^ state.morton[end - 1];
+    if (diff != 0 && depth + ceil_log2(count) < max_depth - 1) {
+        int bit = 31;
+        while (!(diff & (1u << bit))) bit--;
+        mid = std::partition_point(state.morton.begin() + begin, state.morton.begin() + end,
+                                   [&](uint32_t code) { return !(code & (1u << bit)); }) - state.morton.begin();
+        axis = 2 - bit % 3;
+    }
+
+    uint32_t left = state.allocate_pair();
+    nodes[node_index].offset = left;
+    nodes[node_index].count = 0;
+    nodes[node_index].axis = axis;
+
+    if (count > task_threshold) {
+#pragma omp task default(none) shared(state) firstprivate(left, begin, mid, depth)
+        build_lbvh(state, left, begin, mid, depth + 1);
+    } else {
+        build_lbvh(state, left, begin, mid, depth + 1);
+    }
+    build_lbvh(state, left + 1, mid, end, depth + 1);
+}
+
+/**
+ * Stable two-pass partition of state.refs[begin, end): count per chunk, then
+ * scatter every chunk into its slot of the scratch buffer and copy back.
+ * @return First index of the right side.
+ */
+template<typename P>
+uint32_t bvh::partition(build_state &state, uint32_t begin, uint32_t end, int chunks, P &&pred) {
+    if (chunks <= 1) {
+        return std::partition(state.refs.begin() + begin, state.refs.begin() + end, pred) - state.refs.begin();
+    }
+
+    std::vector<uint32_t> left_counts(chunks);
+    for_chunks(begin, end, chunks, [&](int c, uint32_t chunk_begin, uint32_t chunk_end) {
+        uint32_t n = 0;
+        for (uint32_t i = chunk_begin; i < chunk_end; i++) {
+            if (pred(state.refs[i])) n++;
+        }
+        left_counts[c] = n;
+    });
+
+    uint32_t mid = begin;
+    for (int c = 0; c < chunks; c++) mid += left_counts[c];
+
+    std::vector<uint32_t> left_offsets(chunks), right_offsets(chunks);
+    uint32_t left = begin, right = mid;
+    for (int c = 0; c < chunks; c++) {
+        uint32_t chunk_begin = begin + uint64_t(end - begin) * c / chunks;
+        uint32_t chunk_end = begin + uint64_t(end - begin) * (c + 1) / chunks;
+        left_offsets[c] = left;
+        right_offsets[c] = right;
+        left += left_counts[c];
+        right += (chunk_end - chunk_begin) - left_counts[c];
+    }
+
+    for_chunks(begin, end, chunks, [&](int c, uint32_t chunk_begin, uint32_t chunk_end) {
+        uint32_t l = left_offsets[c], r = right_offsets[c];
+        for (uint32_t i = chunk_begin; i < chunk_end; i++) {
+            const prim_ref &ref = state.refs[i];
+            state.scratch[pred(ref) ? l++ : r++] = ref;
+        }
+    });
+    for_chunks(begin, end, chunks, [&](int, uint32_t chunk_begin, uint32_t chunk_end) {
+        std::copy(state.scratch.begin() + chunk_begin, state.scratch.begin() + chunk_end,
+                  state.refs.begin() + chunk_begin);
+    });
+    return mid;
+}
+
+void bvh::compute_stats() {
+    stats.node_count = nodes.size();
+    stats.leaf_count = 0;
+    stats.depth = 0;
+    double cost = 0;
+
+    // Parents come before their children, so depths can be filled in one sweep.
+    std::vector<int> node_depth(nodes.size());
+    node_depth[0] = 1;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const bvh_flat_node &node = nodes[i];
+        stats.depth = std::max(stats.depth, node_depth[i]);
+        if (node.is_leaf()) {
+            stats.leaf_count++;
+            cost += intersection_cost * node.box.surface_area() * node.count;
+        } else {
+            cost += traversal_cost * node.box.surface_area();
+            node_depth[node.offset] = node_depth[node.offset + 1] = node_depth[i] + 1;
+        }
+    }
+    float root_area = nodes[0].box.surface_area();
+    stats.sah_cost = root_area > 0 ? float(cost / root_area) : 0;
+}
+
+void bvh::refit(const std::vector<aabb> &prim_boxes) {
+    // Children always come after their parent, so a reverse sweep sees them first.
+    for (size_t i = nodes.size(); i-- > 0;) {
+        bvh_flat_node &node = nodes[i];
+        aabb box;
+        if (node.is_leaf()) {
+            for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+                box.expand(prim_boxes[prim_indices[j]]);
+            }
+        } else {
+            box = surrounding_box(nodes[node.offset].box, nodes[node.offset + 1].box);
+        }
+        node.box = box;
+    }
+}
+
+template<typename F>
+bool bvh::traverse(const ray &r, float t_min, float t_max, F &&hit_prim) const {
+    if (nodes.empty()) return false;
+
+    vec3 inv_dir(1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z());
+    bool dir_neg[3] = {inv_dir.x() < 0, inv_dir.y() < 0, inv_dir.z() < 0};
+
+    uint32_t stack[max_depth];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_any = false;
+
+    while (true) {
+        const bvh_flat_node &node = nodes[current];
+        if (node.box.hit(r, inv_dir, t_min, t_max)) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    if (hit_prim(prim_indices[i], t_max)) {
+                        hit_any = true;
+                    }
+                }
+            } else {
+                // Visit the near child first so t_max shrinks early.
+                uint32_t near = node.offset + dir_neg[node.axis];
+                stack[stack_size++] = node.offset + !dir_neg[node.axis];
+                current = near;
+                continue;
+            }
+        }
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+    }
+    return hit_any;
+}
+
+/**
+ * Top-level acceleration structure over a list of hittables. Objects are only
+ * referenced, so meshes and instances shared between several scenes stay shared.
+ */
+class bvh_node : public hittable {
+public:
+    bvh_node() {}
+
+    explicit bvh_node(const hittable_list &list, bvh_build_mode mode = bvh_build_mode::sah)
+            : bvh_node(list.objects, mode) {}
+
+    explicit bvh_node(const std::vector<shared_ptr<hittable>> &src_objects,
+                      bvh_build_mode mode = bvh_build_mode::sah);
+
+    virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    /**
+     * Refit the tree after objects moved. Nested acceleration structures (meshes,
+     * sub-scenes) have to be refit first.
+     */
+    void refit();
+
+public:
+    std::vector<shared_ptr<hittable>> objects;
+    std::vector<shared_ptr<hittable>> unbounded;    // Objects without a bounding box, tested one by one.
+    bvh accel;
+};
+
+bvh_node::bvh_node(const std::vector<shared_ptr<hittable>> &src_objects, bvh_build_mode mode) {
+    std::vector<aabb> boxes;
+    aabb box;
+    for (const auto &object: src_objects) {
+        if (object->bounding_box(box)) {
+            objects.push_back(object);
+            boxes.push_back(box);
+        } else {
+            unbounded.push_back(object);
+        }
+    }
+    accel.build(boxes, mode);
+}
+
+bool bvh_node::hit(const ray &r, float t_min, float t_max, hit_record &rec) const {
+    bool hit_any = accel.traverse(r, t_min, t_max, [&](uint32_t i, float &closest_so_far) {
+        if (!objects[i]->hit(r, t_min, closest_so_far, rec))
+            return false;
+        closest_so_far = rec.t;
+        return true;
+    });
+
+    float closest_so_far = hit_any ? rec.t : t_max;
+    for (const auto &object: unbounded) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
+            hit_any = true;
+            closest_so_far = rec.t;
+        }
+    }
+    return hit_any;
+}
+
+void bvh_node::refit() {
+    std::vector<aabb> boxes(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        objects[i]->bounding_box(boxes[i]);
+    }
+    accel.refit(boxes);
+}
+
+bool bvh_node::bounding_box(aabb &output_box) const {
+    return unbounded.empty() && accel.bounding_box(output_box);
+}
+
+#endif //RAYTRACER_BVH_H
@@ -18,6 +18,8 @@ public:
      * @param vup View up direction of camera
      * @param vfov  Vertical field-of view in degrees.
      * @param aspect_ratio Width / Height
+     * @param time0 Shutter open time.
+     * @param time1 Shutter close time.
      */
     camera(point3 lookfrom,
            point3 lookat,
@@ -25,7 +27,9 @@ public:
            float vfov,
            float aspect_ratio,
            float aperture,
-           float focus_dist) {
+           float focus_dist,
+           float time0 = 0,
+           float time1 = 0) {
         auto theta = deg_to_rad(vfov);
         auto h = tan(theta / 2.0);
         float viewport_height = 2.0 * h;
@@ -40,20 +44,23 @@ public:
         vertical = focus_dist * viewport_height * v;
         lower_left_corner = origin - horizontal / 2 - vertical / 2 - focus_dist * w;
         lens_radius = aperture / 2;
+        this->time0 = time0;
+        this->time1 = time1;
     }
 
     /**
      * Get the ray pointing to u [0, 1], v[0, 1] of the image.
      * @param u
      * @param v
-     * @return The ray starting from the camera origin.
+     * @return The ray starting from the camera origin, at a random time while the shutter is open.
      */
     ray get_ray(float s, float t) const {
         vec3 rd = lens_radius * random_in_unit_disk();
         vec3 offset = rd.x() * u + rd.y() * v;
         return ray(
                 origin + offset,
-                lower_left_corner + s * horizontal + t * vertical - (origin + offset)
+                lower_left_corner + s * horizontal + t * vertical - (origin + offset),
+                time0 < time1 ? rand_float(time0, time1) : time0
         );
     }
 
@@ -64,6 +71,7 @@ private:
     vec3 vertical;
     vec3 u, v, w;
     float lens_radius;
+    float time0, time1;     // Shutter open / close times
 };
 
 #endif //RAYTRACER_CAMERA_H
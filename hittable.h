@@ -6,6 +6,7 @@
 #define RAYTRACER_HITTABLE_H
 
 #include "rtweekend.h"
+#include "aabb.h"
 
 class material;
 
@@ -33,6 +34,13 @@ public:
      * @return If the ray hits.
      */
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const = 0;
+
+    /**
+     * Bounding box of the object, used to build acceleration structures.
+     * @param output_box Reference to the output box.
+     * @return If the object has a finite bounding box.
+     */
+    virtual bool bounding_box(aabb& output_box) const = 0;
 };
 
 
@@ -32,6 +32,8 @@ public:
 
     bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
 
+    bool bounding_box(aabb &output_box) const override;
+
 public:
     std::vector<shared_ptr<hittable>> objects;
 
@@ -52,4 +54,16 @@ bool hittable_list::hit(const ray &r, float t_min, float t_max, hit_record &rec)
     return hit_any;
 }
 
+bool hittable_list::bounding_box(aabb &output_box) const {
+    if (objects.empty()) return false;
+
+    aabb temp_box;
+    output_box = aabb();
+    for (const auto &object: objects) {
+        if (!object->bounding_box(temp_box)) return false;
+        output_box.expand(temp_box);
+    }
+    return true;
+}
+
 #endif //RAYTRACER_HITTABLE_LIST_H
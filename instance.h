@@ -0,0 +1,77 @@
+#ifndef RAYTRACER_INSTANCE_H
+#define RAYTRACER_INSTANCE_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "transform.h"
+
+class material;
+
+/**
+ * A placed copy of a shared object (a sphere, a triangle_mesh, or a whole bvh_node
+ * sub-scene). The object is referenced, not copied, so a scene built from
+ * instances under a top-level bvh_node costs memory for its unique geometry plus
+ * one small record per instance.
+ */
+class instance : public hittable {
+public:
+    instance() {}
+
+    /**
+     * @param obj Shared object, in its own object space.
+     * @param obj_to_world Placement of the object in the world.
+     * @param m Overrides the material of the object when set.
+     */
+    instance(shared_ptr<hittable> obj, const transform &obj_to_world, shared_ptr<material> m = nullptr)
+            : object(std::move(obj)), xform(obj_to_world), mat_ptr(std::move(m)) {
+        update_box();
+    }
+
+    /**
+     * Move the instance, e.g. between animation frames. The enclosing bvh_node
+     * needs a refit afterwards.
+     */
+    void set_transform(const transform &obj_to_world) {
+        xform = obj_to_world;
+        update_box();
+    }
+
+    /**
+     * Recompute the cached world box, needed after the shared object itself changed.
+     */
+    void update_box() {
+        has_box = object->bounding_box(box);
+        if (has_box) box = xform.box(box);
+    }
+
+    virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
+
+public:
+    shared_ptr<hittable> object;
+    transform xform;
+    shared_ptr<material> mat_ptr;
+    aabb box;
+    bool has_box;
+};
+
+bool instance::hit(const ray &r, float t_min, float t_max, hit_record &rec) const {
+    // The direction is not renormalized, so t is the same in both spaces.
+    ray object_ray(xform.inverse_point(r.origin()), xform.inverse_vector(r.direction()), r.time());
+    if (!object->hit(object_ray, t_min, t_max, rec))
+        return false;
+
+    rec.p = r.at(rec.t);
+    // The object already flipped the normal against the ray, affine maps keep that side.
+    rec.norm = unit_vec(xform.normal(rec.norm));
+    if (mat_ptr) rec.mat_ptr = mat_ptr;
+    return true;
+}
+
+bool instance::bounding_box(aabb &output_box) const {
+    output_box = box;
+    return has_box;
+}
+
+#endif //RAYTRACER_INSTANCE_H
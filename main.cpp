@@ -1,14 +1,22 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <omp.h>
 
 #include "rtweekend.h"
 #include "color.h"
 #include "hittable_list.h"
 #include "sphere.h"
+#include "moving_sphere.h"
 #include "camera.h"
 #include "material.h"
+#include "obj_loader.h"
+#include "bvh.h"
+#include "instance.h"
+#include "progressive.h"
 
 color ray_color(const ray &r, const hittable &world, int depth) {
     hit_record rec;
@@ -33,7 +41,10 @@ color ray_color(const ray &r, const hittable &world, int depth) {
     return (1.0 - t) * color(1.0, 1.0, 1.0) + t * color(0.5, 0.7, 1.0);
 }
 
-hittable_list world_scene() {
+/**
+ * @param motion Let the diffuse spheres bounce up during the shutter interval [0, 1].
+ */
+hittable_list world_scene(bool motion = false) {
     hittable_list world;
 
     auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
@@ -60,7 +71,12 @@ hittable_list world_scene() {
                     // Glass
                     sphere_material = make_shared<dielectric>(1.5);
                 }
-                world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                if (motion && mat < 0.7) {
+                    auto center1 = center + vec3(0, rand_float(0, 0.5), 0);
+                    world.add(make_shared<moving_sphere>(center, center1, 0.0, 1.0, 0.2, sphere_material));
+                } else {
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
             }
         }
     }
@@ -75,18 +91,359 @@ hittable_list world_scene() {
     return world;
 }
 
-int main() {
+/**
+ * A field of side * side randomly placed copies of one small tree. The tree
+ * geometry exists once, every copy is an instance of it under the top-level BVH.
+ */
+hittable_list forest_scene(int side) {
+    hittable_list world;
+
+    auto ground_material = make_shared<lambertian>(color(0.4, 0.5, 0.3));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
+    hittable_list tree_parts;
+    auto trunk = make_shared<lambertian>(color(0.4, 0.25, 0.1));
+    auto leaves = make_shared<lambertian>(color(0.1, 0.5, 0.1));
+    tree_parts.add(make_shared<sphere>(point3(0, 0.3, 0), 0.1, trunk));
+    tree_parts.add(make_shared<sphere>(point3(0, 0.6, 0), 0.3, leaves));
+    tree_parts.add(make_shared<sphere>(point3(0.15, 0.8, 0), 0.2, leaves));
+    tree_parts.add(make_shared<sphere>(point3(-0.1, 0.9, 0.1), 0.15, leaves));
+    auto tree = make_shared<bvh_node>(tree_parts);
+
+    for (int a = 0; a < side; a++) {
+        for (int b = 0; b < side; b++) {
+            point3 position(a - side / 2 + 0.8 * rand_float(), 0, b - side / 2 + 0.8 * rand_float());
+            auto placement = transform::translate(position)
+                             * transform::rotate(vec3(0, 1, 0), rand_float(0, 360))
+                             * transform::scale(rand_float(0.6, 1.2));
+            world.add(make_shared<instance>(tree, placement));
+        }
+    }
+    return world;
+}
+
+/**
+ * Closed UV sphere of unit radius with 2 * rings * segments triangles, for benchmarks
+ * that need a big mesh without an OBJ file at hand.
+ */
+shared_ptr<triangle_mesh> uv_sphere_mesh(int rings, int segments, shared_ptr<material> m) {
+    auto mesh = make_shared<triangle_mesh>();
+    mesh->mat_ptr = std::move(m);
+    for (int i = 0; i <= rings; i++) {
+        float theta = pi * i / rings;
+        for (int j = 0; j < segments; j++) {
+            float phi = 2 * pi * j / segments;
+            mesh->vertices.emplace_back(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+        }
+    }
+    for (int i = 0; i < rings; i++) {
+        for (int j = 0; j < segments; j++) {
+            uint32_t a = i * segments + j, b = i * segments + (j + 1) % segments;
+            uint32_t c = a + segments, d = b + segments;
+            mesh->vertex_indices.insert(mesh->vertex_indices.end(), {a, b, d, a, d, c});
+        }
+    }
+    mesh->build_bvh();
+    return mesh;
+}
+
+/**
+ * @param make_ray Callable returning the next test ray.
+ * @return Number of rays out of ray_count whose closest hit differs between a and b.
+ */
+template<typename F>
+int count_hit_mismatches(const hittable &a, const hittable &b, int ray_count, F &&make_ray) {
+    int mismatches = 0;
+    for (int i = 0; i < ray_count; i++) {
+        ray r = make_ray();
+        hit_record rec_a, rec_b;
+        bool hit_a = a.hit(r, 0.001, inf, rec_a);
+        bool hit_b = b.hit(r, 0.001, inf, rec_b);
+        if (hit_a != hit_b || (hit_a && fabs(rec_a.t - rec_b.t) > 1e-4f * rec_a.t)) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Animate a forest of instances and a large mesh by one frame, then compare a full
+ * BVH rebuild against a refit, and check that both trees give the same hits.
+ * @param mesh_path OBJ to animate, or nullptr for a generated 2M triangle sphere.
+ * @return Process exit code.
+ */
+int bench_refit(const char *mesh_path) {
+    const int ray_count = 100000;
+    int mismatches = 0;
+
+    // Forest: every instance moves up by a random amount.
+    hittable_list forest = forest_scene(1000);
+    auto start = std::chrono::steady_clock::now();
+    bvh_node forest_bvh(forest);
+    double build_time = seconds_since(start);
+
+    for (const auto &object: forest.objects) {
+        if (auto inst = std::dynamic_pointer_cast<instance>(object)) {
+            inst->set_transform(transform::translate(vec3(0, rand_float(0, 0.5), 0)) * inst->xform);
+        }
+    }
+    start = std::chrono::steady_clock::now();
+    forest_bvh.refit();
+    double refit_time = seconds_since(start);
+    start = std::chrono::steady_clock::now();
+    bvh_node forest_rebuilt(forest);
+    double rebuild_time = seconds_since(start);
+
+    // Short rays looking down into the trees. Long ones lose so much precision in the
+    // sphere test that hits can land outside their box, whichever tree is used.
+    int forest_mismatches = count_hit_mismatches(forest_bvh, forest_rebuilt, ray_count, []() {
+        point3 origin(rand_float(-500, 500), 3, rand_float(-500, 500));
+        return ray(origin, vec3(rand_float(-1, 1), -1, rand_float(-1, 1)));
+    });
+    mismatches += forest_mismatches;
+    std::cout << "Forest, " << forest.objects.size() << " objects: build " << build_time << "s, refit "
+              << refit_time << "s, rebuild " << rebuild_time << "s, " << forest_mismatches << "/" << ray_count
+              << " hits differ." << std::endl;
+
+    // Mesh: every vertex is displaced by a wave.
+    shared_ptr<triangle_mesh> mesh;
+    try {
+        auto mat = make_shared<lambertian>(color(0.6, 0.6, 0.6));
+        mesh = mesh_path ? load_obj(mesh_path, mat) : uv_sphere_mesh(1000, 1000, mat);
+    } catch (const std::runtime_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    aabb mesh_box;
+    mesh->bounding_box(mesh_box);
+    float extent = (mesh_box.max() - mesh_box.min()).length();
+    for (auto &v: mesh->vertices) {
+        v += 0.01f * extent * vec3(sin(20 * v.y() / extent), 0, cos(20 * v.x() / extent));
+    }
+
+    start = std::chrono::steady_clock::now();
+    mesh->refit_bvh();
+    refit_time = seconds_since(start);
+    auto rebuilt_mesh = make_shared<triangle_mesh>(*mesh);
+    start = std::chrono::steady_clock::now();
+    rebuilt_mesh->build_bvh();
+    rebuild_time = seconds_since(start);
+
+    int mesh_mismatches = count_hit_mismatches(*mesh, *rebuilt_mesh, ray_count, [&]() {
+        point3 center = mesh_box.centroid();
+        point3 origin = center + 1.5f * extent * random_unit_vec();
+        return ray(origin, center + 0.5f * extent * random_in_unit_sphere() - origin);
+    });
+    mismatches += mesh_mismatches;
+    std::cout << "Mesh, " << mesh->triangle_count() << " triangles: refit " << refit_time << "s, rebuild "
+              << rebuild_time << "s, " << mesh_mismatches << "/" << ray_count << " hits differ." << std::endl;
+
+    return mismatches == 0 ? 0 : 1;
+}
+
+struct preview_options {
+    std::string output_path;    // Image file or FIFO, refreshed with the current estimate.
+    std::string shm_path;       // Shared memory framebuffer, e.g. /dev/shm/raytracer.
+    std::string camera_path;    // Camera settings file, polled between passes.
+    float interval = 1.0;       // Seconds between two refreshes of output_path.
+};
+
+progressive_renderer *active_preview = nullptr;
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_interrupt(int) {
+    stop_requested = 1;
+    if (active_preview) active_preview->cancel();
+}
+
+/**
+ * Render 1 spp passes until max_samples or Ctrl-C, publishing the estimate after the
+ * first pass and then every options.interval seconds. Edits to the camera file
+ * restart the accumulation.
+ */
+void render_progressive(const hittable &world, camera_settings settings, const preview_options &options,
+                        int image_width, int image_height, int max_samples, int max_depth) {
+    progressive_renderer renderer(world, ray_color, settings.make(), image_width, image_height, max_depth);
+    shm_framebuffer shm(options.shm_path, image_width, image_height);
+    if (!options.shm_path.empty() && !shm.is_open()) {
+        std::cerr << "Cannot map " << options.shm_path << std::endl;
+    }
+
+    // No SA_RESTART, so Ctrl-C also interrupts a write to a stalled FIFO reader.
+    active_preview = &renderer;
+    struct sigaction interrupt {}, ignore {}, default_action {};
+    interrupt.sa_handler = on_interrupt;
+    sigemptyset(&interrupt.sa_mask);
+    sigaction(SIGINT, &interrupt, nullptr);
+    // A FIFO reader going away must not kill the render.
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, nullptr);
+
+    // Compared by contents, timestamps miss quick edits that keep the size.
+    uint32_t generation = 0;
+    std::string camera_text;
+    if (!options.camera_path.empty()) camera_text = read_file(options.camera_path);
+
+    auto publish = [&](bool abortable) {
+        if (!options.output_path.empty()) publish_ppm(renderer, options.output_path, abortable);
+        if (shm.is_open()) shm.publish(renderer, generation);
+    };
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto last_publish = start_time;
+    while (!stop_requested && renderer.pass_count() < max_samples) {
+        // Restart on camera edits, the scene and buffers stay as they are.
+        // Editors truncate or replace the file while saving, an empty read is not an edit.
+        std::string text = options.camera_path.empty() ? camera_text : read_file(options.camera_path);
+        camera_settings edited = settings;
+        if (!text.empty() && text != camera_text) {
+            camera_text = text;
+            edited.parse(camera_text);
+        }
+        if (edited != settings) {
+            settings = edited;
+            renderer.restart(settings.make());
+            generation++;
+            start_time = std::chrono::steady_clock::now();
+            std::cerr << "\nCamera changed, restarting." << std::endl;
+        }
+
+        if (!renderer.render_pass()) break;
+
+        auto now = std::chrono::steady_clock::now();
+        if (renderer.pass_count() == 1) {
+            publish(true);
+            last_publish = now;
+            std::cerr << "First image in " << std::chrono::duration<double>(now - start_time).count() << "s."
+                      << std::endl;
+        } else if (std::chrono::duration<double>(now - last_publish).count() >= options.interval) {
+            publish(true);
+            last_publish = now;
+        }
+        std::cerr << "\rSamples per pixel: " << renderer.pass_count() << std::flush;
+    }
+
+    // Final estimate, also after Ctrl-C.
+    publish(false);
+    default_action.sa_handler = SIG_DFL;
+    sigemptyset(&default_action.sa_mask);
+    sigaction(SIGINT, &default_action, nullptr);
+    sigaction(SIGPIPE, &default_action, nullptr);
+    active_preview = nullptr;
+    std::cerr << "\nStopped at " << renderer.pass_count() << " samples per pixel." << std::endl;
+}
+
+int usage(const char *program) {
+    std::cerr << "Usage: " << program << " [mesh.obj] [--motion | --forest [side]] [--bench-refit]\n"
+              << "       [--progressive image.ppm|fifo] [--shm path] [--camera-file path] [--interval s]"
+              << std::endl;
+    return 2;
+}
+
+int main(int argc, char **argv) {
     const float aspect_ratio = 16.0 / 9.0;
     const int image_width = 1200;
     const int image_height = static_cast<int>(image_width / aspect_ratio);
     const int samples_per_pixel = 500;    // Used for antialiasing
     const int max_depth = 50;
 
-    std::ofstream fout("out/image.ppm");
-    auto image = std::vector<std::vector<color>>(image_height, std::vector<color>(image_width));
+    const char *mesh_path = nullptr;
+    bool motion = false;
+    int forest_side = 0;    // Render forest_scene(forest_side) instead of world_scene() when set.
+    bool bench = false;
+    bool progressive = false;
+    preview_options options;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool takes_value = !strcmp(arg, "--progressive") || !strcmp(arg, "--shm")
+                           || !strcmp(arg, "--camera-file") || !strcmp(arg, "--interval");
+        if (takes_value && i + 1 == argc) {
+            std::cerr << arg << " needs a value." << std::endl;
+            return usage(argv[0]);
+        }
+
+        if (!strcmp(arg, "--progressive")) {
+            progressive = true;
+            options.output_path = argv[++i];
+        } else if (!strcmp(arg, "--shm")) {
+            progressive = true;
+            options.shm_path = argv[++i];
+        } else if (!strcmp(arg, "--motion")) {
+            motion = true;
+        } else if (!strcmp(arg, "--forest")) {
+            forest_side = 1000;
+            // The side is optional, a following non-number is left for the next round.
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                char *end = nullptr;
+                long side = std::strtol(argv[i + 1], &end, 10);
+                if (*end == '\0') {
+                    if (side < 1 || side > 10000) {
+                        std::cerr << "Invalid forest side " << argv[i + 1] << "." << std::endl;
+                        return usage(argv[0]);
+                    }
+                    forest_side = static_cast<int>(side);
+                    i++;
+                }
+            }
+        } else if (!strcmp(arg, "--bench-refit")) {
+            bench = true;
+        } else if (!strcmp(arg, "--camera-file")) {
+            options.camera_path = argv[++i];
+        } else if (!strcmp(arg, "--interval")) {
+            char *end = nullptr;
+            options.interval = std::strtof(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(options.interval >= 0)) {
+                std::cerr << "Invalid interval " << argv[i] << "." << std::endl;
+                return usage(argv[0]);
+            }
+        } else if (!strncmp(arg, "--", 2)) {
+            std::cerr << "Unknown option " << arg << "." << std::endl;
+            return usage(argv[0]);
+        } else if (mesh_path) {
+            std::cerr << "Only one mesh can be given." << std::endl;
+            return usage(argv[0]);
+        } else {
+            mesh_path = arg;
+        }
+    }
+    if (bench) {
+        return bench_refit(mesh_path);
+    }
+
+    // Previews start faster on the Morton code BVH.
+    auto bvh_mode = progressive ? bvh_build_mode::lbvh : bvh_build_mode::sah;
 
     // World
-    hittable_list world = world_scene();
+    hittable_list world = forest_side > 0 ? forest_scene(forest_side) : world_scene(motion);
+
+    // Optional triangle mesh given on the command line, added to the scene as is.
+    if (mesh_path) {
+        auto load_start = std::chrono::steady_clock::now();
+        shared_ptr<triangle_mesh> mesh;
+        try {
+            mesh = load_obj(mesh_path, make_shared<lambertian>(color(0.6, 0.6, 0.6)), bvh_mode);
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        auto load_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - load_start).count();
+        auto triangles = std::max<size_t>(mesh->triangle_count(), 1);
+        std::cout << "Loaded " << mesh->triangle_count() << " triangles from " << mesh_path << " in "
+                  << double(load_ms) / 1000 << "s, " << mesh->memory_usage() / triangles << " bytes/triangle."
+                  << std::endl;
+        std::cout << "Mesh BVH: " << mesh->accel.stats << std::endl;
+        world.add(mesh);
+    }
+
+    // Top-level BVH over the scene objects.
+    bvh_node world_bvh(world, bvh_mode);
+    std::cout << "Scene BVH over " << world.objects.size() << " objects: " << world_bvh.accel.stats << std::endl;
 
 //    hittable_list world;
 //
@@ -104,13 +461,27 @@ int main() {
 //    world.add(make_shared<sphere>(point3(-1.0, 0.0, -1.0), -0.4, material_left));
 
     // Camera
-    point3 lookfrom(13, 2, 4);
-    point3 lookat(0, 0, 0);
-    vec3 vup(0, 1, 0);
-    auto dist_to_focus = 10;
-    auto aperture = 0.1;
+    camera_settings settings;
+    settings.lookfrom = point3(13, 2, 4);
+    settings.lookat = point3(0, 0, 0);
+    settings.vup = vec3(0, 1, 0);
+    settings.vfov = 20.0;
+    settings.aspect_ratio = aspect_ratio;
+    settings.focus_dist = 10;
+    settings.aperture = 0.1;
+    // Only open the shutter when something moves, a closed one saves a random number per ray.
+    settings.time0 = 0.0;
+    settings.time1 = motion ? 1.0 : 0.0;
+    if (!options.camera_path.empty()) settings.read(options.camera_path);
 
-    camera cam(lookfrom, lookat, vup, 20.0, aspect_ratio, aperture, dist_to_focus);
+    if (progressive) {
+        render_progressive(world_bvh, settings, options, image_width, image_height, samples_per_pixel, max_depth);
+        return 0;
+    }
+
+    camera cam = settings.make();
+    std::ofstream fout("out/image.ppm");
+    auto image = std::vector<std::vector<color>>(image_height, std::vector<color>(image_width));
 
     auto start_time = std::chrono::steady_clock::now();
 
@@ -134,7 +505,7 @@ int main() {
                 auto u = (i + rand_float()) / (image_width - 1);
                 auto v = (j + rand_float()) / (image_height - 1);
                 ray r = cam.get_ray(u, v);
-                pixel_color += ray_color(r, world, max_depth);
+                pixel_color += ray_color(r, world_bvh, max_depth);
             }
             image[j][i] = pixel_color / samples_per_pixel;
 
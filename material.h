@@ -31,7 +31,7 @@ public:
         if (scatter_direction.near_zero())
             scatter_direction = rec.norm;
 
-        scattered = ray(rec.p, scatter_direction);
+        scattered = ray(rec.p, scatter_direction, r_in.time());
         attenuation = albedo;
         return true;
     }
@@ -46,7 +46,7 @@ public:
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override {
         vec3 reflected = reflect(r_in.direction(), unit_vec(rec.norm));
-        scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere());
+        scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
         attenuation = albedo;
         return (dot(scattered.direction(), rec.norm) > 0);
     }
@@ -75,7 +75,7 @@ public:
             // Refract
             direction = refract(unit_dir, unit_vec(rec.norm), refraction_ratio);
         }
-        scattered = ray(rec.p, direction);
+        scattered = ray(rec.p, direction, r_in.time());
         return true;
     }
 
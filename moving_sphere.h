@@ -0,0 +1,73 @@
+#ifndef RAYTRACER_MOVING_SPHERE_H
+#define RAYTRACER_MOVING_SPHERE_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+
+class material;
+
+/**
+ * Sphere whose center moves linearly from center0 at time0 to center1 at time1,
+ * and rests at either end outside of that interval.
+ */
+class moving_sphere : public hittable {
+public:
+    moving_sphere() {}
+
+    moving_sphere(point3 cen0, point3 cen1, float time0, float time1, float r, shared_ptr<material> m)
+            : center0(cen0), center1(cen1), time0(time0), time1(time1), radius(r), mat_ptr(m) {};
+
+    virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
+
+    /**
+     * The box covers the sphere over the whole [time0, time1] motion.
+     */
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    point3 center(float time) const {
+        if (time1 == time0) return center0;
+        return center0 + clamp((time - time0) / (time1 - time0), 0, 1) * (center1 - center0);
+    }
+
+public:
+    point3 center0, center1;
+    float time0, time1;
+    float radius;
+    shared_ptr<material> mat_ptr;
+};
+
+bool moving_sphere::hit(const ray &r, float t_min, float t_max, hit_record &rec) const {
+    point3 cen = center(r.time());
+    vec3 oc = r.origin() - cen;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(r.direction(), oc);
+    auto c = oc.length_squared() - radius * radius;
+    auto discriminator = half_b * half_b - a * c;
+    if (discriminator < 0) {
+        return false;
+    }
+
+    auto sqrtd = sqrt(discriminator);
+    auto root = (-half_b - sqrtd) / a;
+    if (root < t_min || t_max < root) {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || root > t_max) {
+            return false;
+        }
+    }
+
+    rec.t = root;
+    rec.p = r.at(rec.t);
+    vec3 outward_norm = (rec.p - cen) / radius;
+    rec.set_face_norm(r, outward_norm);
+    rec.mat_ptr = mat_ptr;
+    return true;
+}
+
+bool moving_sphere::bounding_box(aabb &output_box) const {
+    auto r = vec3(fabs(radius), fabs(radius), fabs(radius));
+    output_box = surrounding_box(aabb(center0 - r, center0 + r), aabb(center1 - r, center1 + r));
+    return true;
+}
+
+#endif //RAYTRACER_MOVING_SPHERE_H
@@ -0,0 +1,222 @@
+#ifndef RAYTRACER_OBJ_LOADER_H
+#define RAYTRACER_OBJ_LOADER_H
+
+#include "rtweekend.h"
+#include "triangle_mesh.h"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Cursor over a memory-mapped OBJ file. Everything is parsed in place, no line is
+ * ever copied out, so loading does not allocate besides growing the mesh arrays.
+ */
+class obj_reader {
+public:
+    obj_reader(const char *begin, const char *end) : cur(begin), end(end) {}
+
+    bool done() const { return cur >= end; }
+
+    void skip_blanks() {
+        while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r')) cur++;
+    }
+
+    void skip_line() {
+        while (cur < end && *cur != '\n') cur++;
+        if (cur < end) cur++;
+    }
+
+    bool at_line_end() {
+        skip_blanks();
+        return cur >= end || *cur == '\n' || *cur == '#';
+    }
+
+    /**
+     * Consume a keyword such as "v" or "vn", which must be followed by a blank.
+     */
+    bool keyword(const char *kw) {
+        const char *p = cur;
+        while (*kw) {
+            if (p >= end || *p != *kw) return false;
+            p++, kw++;
+        }
+        if (p < end && *p != ' ' && *p != '\t') return false;
+        cur = p;
+        return true;
+    }
+
+    /**
+     * Locale independent float parser, plenty precise for single precision.
+     */
+    bool parse_float(float &out) {
+        skip_blanks();
+        const char *p = cur;
+        bool neg = false;
+        if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+        double value = 0;
+        bool any_digit = false;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0'), any_digit = true;
+        if (p < end && *p == '.') {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9') value += (*p++ - '0') * scale, scale *= 0.1, any_digit = true;
+        }
+        if (!any_digit) return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool exp_neg = false;
+            if (p < end && (*p == '-' || *p == '+')) exp_neg = *p++ == '-';
+            int exp = 0;
+            while (p < end && *p >= '0' && *p <= '9') exp = exp * 10 + (*p++ - '0');
+            value *= std::pow(10.0, exp_neg ? -exp : exp);
+        }
+        out = float(neg ? -value : value);
+        cur = p;
+        return true;
+    }
+
+    bool parse_int(long &out) {
+        const char *p = cur;
+        bool neg = false;
+        if (p < end && *p == '-') neg = true, p++;
+        if (p >= end || *p < '0' || *p > '9') return false;
+        long value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+        out = neg ? -value : value;
+        cur = p;
+        return true;
+    }
+
+    /**
+     * Parse one face corner: v, v/vt, v//vn or v/vt/vn. Indices are 1-based, negative
+     * ones count back from the latest element.
+     */
+    bool parse_corner(size_t vertex_count, size_t normal_count, uint32_t &v, uint32_t &n) {
+        long idx;
+        if (!parse_int(idx) || !resolve(idx, vertex_count, v)) return false;
+        n = triangle_mesh::no_normal;
+        if (cur < end && *cur == '/') {
+            cur++;
+            long ignored;
+            parse_int(ignored);     // Texture coordinates are not used.
+            if (cur < end && *cur == '/') {
+                cur++;
+                if (!parse_int(idx) || !resolve(idx, normal_count, n)) return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    size_t line = 1;
+
+private:
+    static bool resolve(long idx, size_t count, uint32_t &out) {
+        long resolved = idx > 0 ? idx - 1 : long(count) + idx;
+        if (idx == 0 || resolved < 0 || size_t(resolved) >= count) return false;
+        out = uint32_t(resolved);
+        return true;
+    }
+
+    const char *cur;
+    const char *end;
+};
+
+/**
+ * Load the triangles of an OBJ file into one mesh. Polygons are fan-triangulated,
+ * groups, texture coordinates and materials are ignored.
+ * @param path Path to the .obj file.
+ * @param m Material shared by the whole mesh.
+ * @param mode How to build the mesh BVH.
+ * @return The mesh with its BVH built. Throws std::runtime_error if the file cannot be read.
+ */
+shared_ptr<triangle_mesh> load_obj(const std::string &path, shared_ptr<material> m,
+                                   bvh_build_mode mode = bvh_build_mode::sah) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_t size = st.st_size;
+
+    void *data = nullptr;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + path);
+    }
+    if (data) {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+
+    auto mesh = make_shared<triangle_mesh>();
+    mesh->mat_ptr = std::move(m);
+    bool any_normal = false;
+
+    const char *begin = static_cast<const char *>(data);
+    obj_reader in(begin, begin + size);
+    while (!in.done()) {
+        in.skip_blanks();
+        bool ok = true;
+        if (in.keyword("v")) {
+            float x, y, z;
+            ok = in.parse_float(x) && in.parse_float(y) && in.parse_float(z);
+            mesh->vertices.emplace_back(x, y, z);
+        } else if (in.keyword("vn")) {
+            float x, y, z;
+            ok = in.parse_float(x) && in.parse_float(y) && in.parse_float(z);
+            mesh->normals.emplace_back(x, y, z);
+        } else if (in.keyword("f")) {
+            uint32_t v0, n0, v_prev, n_prev, v, n;
+            in.skip_blanks();
+            ok = in.parse_corner(mesh->vertices.size(), mesh->normals.size(), v0, n0);
+            in.skip_blanks();
+            ok = ok && in.parse_corner(mesh->vertices.size(), mesh->normals.size(), v_prev, n_prev);
+            // A face needs at least three corners.
+            ok = ok && !in.at_line_end();
+            while (ok && !in.at_line_end()) {
+                ok = in.parse_corner(mesh->vertices.size(), mesh->normals.size(), v, n);
+                if (!ok) break;
+                mesh->vertex_indices.insert(mesh->vertex_indices.end(), {v0, v_prev, v});
+                mesh->normal_indices.insert(mesh->normal_indices.end(), {n0, n_prev, n});
+                any_normal = any_normal || n0 != triangle_mesh::no_normal;
+                v_prev = v;
+                n_prev = n;
+            }
+        }
+        if (!ok) {
+            if (data) munmap(data, size);
+            throw std::runtime_error(path + ":" + std::to_string(in.line) + ": malformed statement");
+        }
+        in.skip_line();
+        in.line++;
+    }
+
+    if (data) munmap(data, size);
+
+    if (!any_normal) {
+        mesh->normal_indices = std::vector<uint32_t>();
+    }
+    mesh->vertices.shrink_to_fit();
+    mesh->normals.shrink_to_fit();
+    mesh->vertex_indices.shrink_to_fit();
+    mesh->normal_indices.shrink_to_fit();
+    mesh->build_bvh(mode);
+    return mesh;
+}
+
+#endif //RAYTRACER_OBJ_LOADER_H
@@ -0,0 +1,333 @@
+#ifndef RAYTRACER_PROGRESSIVE_H
+#define RAYTRACER_PROGRESSIVE_H
+
+#include "rtweekend.h"
+#include "color.h"
+#include "hittable.h"
+#include "camera.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Everything needed to (re)build the camera, so it can be edited while previewing.
+ */
+struct camera_settings {
+    point3 lookfrom;
+    point3 lookat;
+    vec3 vup;
+    float vfov;
+    float aspect_ratio;
+    float aperture;
+    float focus_dist;
+    float time0 = 0;
+    float time1 = 0;
+
+    camera make() const {
+        return camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, focus_dist, time0, time1);
+    }
+
+    bool operator==(const camera_settings &other) const;
+    bool operator!=(const camera_settings &other) const { return !(*this == other); }
+
+    /**
+     * Read "key values" lines (lookfrom x y z, lookat x y z, vup x y z, vfov f, aperture f,
+     * focus_dist f). Keys that are missing keep their current value.
+     * @return If the file could be opened.
+     */
+    bool read(const std::string &path);
+
+    /**
+     * Same as read(), from the contents of a settings file.
+     */
+    void parse(const std::string &text);
+};
+
+/**
+ * @return Whole contents of the file at path, empty if it cannot be read.
+ */
+std::string read_file(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+bool camera_settings::operator==(const camera_settings &other) const {
+    for (int i = 0; i < 3; i++) {
+        if (lookfrom[i] != other.lookfrom[i] || lookat[i] != other.lookat[i] || vup[i] != other.vup[i]) {
+            return false;
+        }
+    }
+    return vfov == other.vfov && aspect_ratio == other.aspect_ratio && aperture == other.aperture
+           && focus_dist == other.focus_dist && time0 == other.time0 && time1 == other.time1;
+}
+
+bool camera_settings::read(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    parse(read_file(path));
+    return true;
+}
+
+void camera_settings::parse(const std::string &text) {
+    std::istringstream in(text);
+    std::string line, key;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        if (!(fields >> key)) continue;
+        float x, y, z;
+        if (key == "lookfrom" && fields >> x >> y >> z) lookfrom = point3(x, y, z);
+        else if (key == "lookat" && fields >> x >> y >> z) lookat = point3(x, y, z);
+        else if (key == "vup" && fields >> x >> y >> z) vup = vec3(x, y, z);
+        else if (key == "vfov" && fields >> x) vfov = x;
+        else if (key == "aperture" && fields >> x) aperture = x;
+        else if (key == "focus_dist" && fields >> x) focus_dist = x;
+    }
+}
+
+/**
+ * Renders the image in passes of one sample per pixel and keeps the running sum,
+ * so a usable estimate exists after the first pass and improves from there.
+ * Restarting for a new camera reuses the buffers and leaves the scene alone.
+ */
+class progressive_renderer {
+public:
+    using shade_fn = color (*)(const ray &r, const hittable &world, int depth);
+
+    progressive_renderer(const hittable &world, shade_fn shade, const camera &cam,
+                         int image_width, int image_height, int max_depth)
+            : width(image_width), height(image_height), world(world), shade(shade), cam(cam), max_depth(max_depth),
+              accum(image_width * image_height), row_passes(image_height, 0) {}
+
+    /**
+     * Throw away the accumulated samples and continue with a new camera.
+     */
+    void restart(const camera &new_cam) {
+        cam = new_cam;
+        std::fill(accum.begin(), accum.end(), color(0, 0, 0));
+        std::fill(row_passes.begin(), row_passes.end(), 0);
+        passes = 0;
+        cancelled = false;
+    }
+
+    /**
+     * Stop the running pass as soon as possible. Safe to call from other threads
+     * and from signal handlers.
+     */
+    void cancel() { cancelled = true; }
+
+    bool is_cancelled() const { return cancelled; }
+
+    /**
+     * Add one sample to every pixel.
+     * @return If the pass completed. A cancelled pass keeps the rows it finished.
+     */
+    bool render_pass();
+
+    /**
+     * @return Number of completed passes, i.e. samples per pixel, since the last restart.
+     */
+    int pass_count() const { return passes; }
+
+    /**
+     * @return Current estimate of pixel (i, j), j counted from the bottom row.
+     */
+    color pixel(int i, int j) const {
+        int n = row_passes[j];
+        return n > 0 ? accum[j * width + i] / n : color(0, 0, 0);
+    }
+
+    void write_ppm(std::ostream &out) const;
+
+public:
+    const int width;
+    const int height;
+
+private:
+    const hittable &world;
+    shade_fn shade;
+    camera cam;
+    int max_depth;
+    std::vector<color> accum;       // Sum of all samples, bottom row first.
+    std::vector<int> row_passes;    // Samples per pixel in each row, rows differ after a cancelled pass.
+    int passes = 0;
+    std::atomic<bool> cancelled{false};
+};
+
+bool progressive_renderer::render_pass() {
+#pragma omp parallel for schedule(dynamic, 1) // NOLINT
+    for (int j = height - 1; j >= 0; --j) {
+        if (cancelled) continue;
+        for (int i = 0; i < width; ++i) {
+            auto u = (i + rand_float()) / (width - 1);
+            auto v = (j + rand_float()) / (height - 1);
+            ray r = cam.get_ray(u, v);
+            accum[j * width + i] += shade(r, world, max_depth);
+        }
+        row_passes[j]++;
+    }
+    if (cancelled) return false;
+    passes++;
+    return true;
+}
+
+void progressive_renderer::write_ppm(std::ostream &out) const {
+    out << "P3\n" << width << ' ' << height << "\n255\n";
+    for (int j = height - 1; j >= 0; --j) {
+        for (int i = 0; i < width; ++i) {
+            write_color(out, pixel(i, j));
+        }
+    }
+}
+
+/**
+ * Publish the current estimate as a PPM at path. A FIFO gets the image streamed
+ * into it, and the update is skipped while no reader has it open. A reader that
+ * stops draining the pipe for fifo_timeout_ms drops the frame: the pipe is closed
+ * early and the reader sees a truncated image. Any other path is replaced
+ * atomically through a rename, so viewers that reload the file on change never
+ * see it half written.
+ * @param abortable If a cancelled render also drops the frame. The final image
+ * after Ctrl-C is published with this off, so a waiting reader still gets it.
+ * @return If the image was written.
+ */
+bool publish_ppm(const progressive_renderer &renderer, const std::string &path, bool abortable = true) {
+    std::ostringstream image;
+    renderer.write_ppm(image);
+    const std::string data = image.str();
+
+    struct stat st {};
+    if (stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+        const int fifo_timeout_ms = 1000;
+        int fd = open(path.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd < 0) return false;   // ENXIO: nobody is reading.
+
+        size_t written = 0;
+        int waited_ms = 0;
+        while (written < data.size() && !(abortable && renderer.is_cancelled())) {
+            ssize_t n = write(fd, data.data() + written, data.size() - written);
+            if (n > 0) {
+                written += n;
+                waited_ms = 0;
+                continue;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR) break;
+            if (waited_ms >= fifo_timeout_ms) break;
+            // Pipe is full, give the reader a moment to catch up.
+            pollfd pfd{fd, POLLOUT, 0};
+            poll(&pfd, 1, 100);
+            waited_ms += 100;
+        }
+        close(fd);
+        return written == data.size();
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary);
+    out << data;
+    out.close();
+    return out && std::rename(tmp_path.c_str(), path.c_str()) == 0;
+}
+
+/**
+ * Framebuffer in a shared memory file (e.g. under /dev/shm) that other processes
+ * can map and poll. The header is followed by width * height linear RGB floats,
+ * bottom row first.
+ *
+ * sequence is odd while an update is being written. A reader loads it (acquire),
+ * retries while it is odd, copies the header and pixels, issues an acquire fence
+ * and loads sequence again. The copy is consistent only if both loads are equal,
+ * otherwise it retries.
+ */
+class shm_framebuffer {
+public:
+    struct header {
+        char magic[4];      // "RTFB"
+        uint32_t width;
+        uint32_t height;
+        std::atomic<uint32_t> sequence;
+        uint32_t generation;    // Bumped on every restart.
+        uint32_t passes;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "sequence must be usable across processes");
+
+    shm_framebuffer(const std::string &path, int width, int height);
+
+    ~shm_framebuffer();
+
+    shm_framebuffer(const shm_framebuffer &) = delete;
+
+    shm_framebuffer &operator=(const shm_framebuffer &) = delete;
+
+    bool is_open() const { return data != nullptr; }
+
+    void publish(const progressive_renderer &renderer, uint32_t generation);
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+};
+
+shm_framebuffer::shm_framebuffer(const std::string &path, int width, int height) {
+    size = sizeof(header) + size_t(width) * height * 3 * sizeof(float);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+    if (ftruncate(fd, off_t(size)) == 0) {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) data = p;
+    }
+    close(fd);
+    if (!data) return;
+
+    auto *h = static_cast<header *>(data);
+    std::copy_n("RTFB", 4, h->magic);
+    h->width = width;
+    h->height = height;
+    h->sequence.store(0, std::memory_order_relaxed);
+    h->generation = 0;
+    h->passes = 0;
+}
+
+shm_framebuffer::~shm_framebuffer() {
+    if (data) munmap(data, size);
+}
+
+void shm_framebuffer::publish(const progressive_renderer &renderer, uint32_t generation) {
+    if (!data) return;
+    auto *h = static_cast<header *>(data);
+    auto *pixels = reinterpret_cast<float *>(h + 1);
+    uint32_t sequence = h->sequence.load(std::memory_order_relaxed);
+    h->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (int j = 0; j < renderer.height; ++j) {
+        for (int i = 0; i < renderer.width; ++i) {
+            color c = renderer.pixel(i, j);
+            float *p = pixels + 3 * (size_t(j) * renderer.width + i);
+            p[0] = c.r();
+            p[1] = c.g();
+            p[2] = c.b();
+        }
+    }
+    h->generation = generation;
+    h->passes = renderer.pass_count();
+
+    std::atomic_thread_fence(std::memory_order_release);
+    h->sequence.store(sequence + 2, std::memory_order_relaxed);
+}
+
+#endif //RAYTRACER_PROGRESSIVE_H
@@ -9,14 +9,20 @@
 
 class ray {
 public:
-    ray() {}
+    ray() : tm(0) {}
 
-    ray(const point3 &origin, const vec3 &direction) : orig(origin), dir(direction) {}
+    ray(const point3 &origin, const vec3 &direction, float time = 0.0)
+            : orig(origin), dir(direction), tm(time) {}
 
     point3 origin() const { return orig; }
 
     vec3 direction() const { return dir; }
 
+    /**
+     * @return Time at which the ray was sent, within the camera shutter interval.
+     */
+    float time() const { return tm; }
+
     point3 at(float t) const {
         return orig + t * dir;
     }
@@ -24,6 +30,7 @@ public:
 private:
     point3 orig;
     vec3 dir;
+    float tm;
 };
 
 
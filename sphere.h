@@ -16,6 +16,8 @@ public:
 
     virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
 
+    virtual bool bounding_box(aabb &output_box) const override;
+
 public:
     point3 center;
     float radius;
@@ -51,4 +53,11 @@ bool sphere::hit(const ray &r, float t_min, float t_max, hit_record &rec) const
     return true;
 }
 
+bool sphere::bounding_box(aabb &output_box) const {
+    // Radius may be negative for hollow spheres.
+    auto r = vec3(fabs(radius), fabs(radius), fabs(radius));
+    output_box = aabb(center - r, center + r);
+    return true;
+}
+
 #endif //RAYTRACER_SPHERE_H
@@ -0,0 +1,137 @@
+#ifndef RAYTRACER_TRANSFORM_H
+#define RAYTRACER_TRANSFORM_H
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+/**
+ * Affine transform stored as a 3x4 matrix (rotation/scale plus translation)
+ * together with its inverse.
+ */
+class transform {
+public:
+    transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}, inv{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+    static transform translate(const vec3 &offset);
+
+    static transform scale(float s);
+
+    static transform scale(const vec3 &s);
+
+    /**
+     * Rotation about an arbitrary axis through the origin.
+     * @param axis Rotation axis, does not need to be normalized.
+     * @param degrees Counter-clockwise angle looking down the axis.
+     */
+    static transform rotate(const vec3 &axis, float degrees);
+
+    point3 point(const point3 &p) const { return apply(m, p, 1); }
+
+    vec3 vector(const vec3 &v) const { return apply(m, v, 0); }
+
+    point3 inverse_point(const point3 &p) const { return apply(inv, p, 1); }
+
+    vec3 inverse_vector(const vec3 &v) const { return apply(inv, v, 0); }
+
+    /**
+     * Normals transform with the inverse transpose of the matrix.
+     */
+    vec3 normal(const vec3 &n) const {
+        return vec3(inv[0][0] * n[0] + inv[1][0] * n[1] + inv[2][0] * n[2],
+                    inv[0][1] * n[0] + inv[1][1] * n[1] + inv[2][1] * n[2],
+                    inv[0][2] * n[0] + inv[1][2] * n[1] + inv[2][2] * n[2]);
+    }
+
+    /**
+     * @return Box around the 8 transformed corners of the box.
+     */
+    aabb box(const aabb &b) const;
+
+    /**
+     * Compose two transforms, the right one is applied first.
+     */
+    friend transform operator*(const transform &a, const transform &b);
+
+private:
+    static vec3 apply(const float mat[3][4], const vec3 &v, float w) {
+        return vec3(mat[0][0] * v[0] + mat[0][1] * v[1] + mat[0][2] * v[2] + mat[0][3] * w,
+                    mat[1][0] * v[0] + mat[1][1] * v[1] + mat[1][2] * v[2] + mat[1][3] * w,
+                    mat[2][0] * v[0] + mat[2][1] * v[1] + mat[2][2] * v[2] + mat[2][3] * w);
+    }
+
+    static void multiply(const float a[3][4], const float b[3][4], float out[3][4]);
+
+    float m[3][4];
+    float inv[3][4];
+};
+
+transform transform::translate(const vec3 &offset) {
+    transform t;
+    for (int i = 0; i < 3; i++) {
+        t.m[i][3] = offset[i];
+        t.inv[i][3] = -offset[i];
+    }
+    return t;
+}
+
+transform transform::scale(float s) {
+    return scale(vec3(s, s, s));
+}
+
+transform transform::scale(const vec3 &s) {
+    transform t;
+    for (int i = 0; i < 3; i++) {
+        t.m[i][i] = s[i];
+        t.inv[i][i] = 1 / s[i];
+    }
+    return t;
+}
+
+transform transform::rotate(const vec3 &axis, float degrees) {
+    // Rodrigues' rotation formula, the inverse of a rotation is its transpose.
+    vec3 a = unit_vec(axis);
+    float s = sin(deg_to_rad(degrees));
+    float c = cos(deg_to_rad(degrees));
+    float r[3][3] = {
+            {a.x() * a.x() * (1 - c) + c,         a.x() * a.y() * (1 - c) - a.z() * s, a.x() * a.z() * (1 - c) + a.y() * s},
+            {a.y() * a.x() * (1 - c) + a.z() * s, a.y() * a.y() * (1 - c) + c,         a.y() * a.z() * (1 - c) - a.x() * s},
+            {a.z() * a.x() * (1 - c) - a.y() * s, a.z() * a.y() * (1 - c) + a.x() * s, a.z() * a.z() * (1 - c) + c},
+    };
+    transform t;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            t.m[i][j] = r[i][j];
+            t.inv[i][j] = r[j][i];
+        }
+    }
+    return t;
+}
+
+aabb transform::box(const aabb &b) const {
+    aabb out;
+    for (int i = 0; i < 8; i++) {
+        point3 corner(i & 1 ? b.max().x() : b.min().x(),
+                      i & 2 ? b.max().y() : b.min().y(),
+                      i & 4 ? b.max().z() : b.min().z());
+        out.expand(point(corner));
+    }
+    return out;
+}
+
+void transform::multiply(const float a[3][4], const float b[3][4], float out[3][4]) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            out[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j] + (j == 3 ? a[i][3] : 0);
+        }
+    }
+}
+
+transform operator*(const transform &a, const transform &b) {
+    transform t;
+    transform::multiply(a.m, b.m, t.m);
+    // (AB)^-1 = B^-1 A^-1
+    transform::multiply(b.inv, a.inv, t.inv);
+    return t;
+}
+
+#endif //RAYTRACER_TRANSFORM_H
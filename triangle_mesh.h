@@ -0,0 +1,217 @@
+#ifndef RAYTRACER_TRIANGLE_MESH_H
+#define RAYTRACER_TRIANGLE_MESH_H
+
+#include "rtweekend.h"
+#include "hittable.h"
+#include "bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+class material;
+
+/**
+ * Indexed triangle mesh. All triangles share the vertex and normal arrays and one
+ * material, and are intersected through a per-mesh BVH instead of living in
+ * hittable_list as separate objects.
+ */
+class triangle_mesh : public hittable {
+public:
+    triangle_mesh() {}
+
+    triangle_mesh(std::vector<point3> verts, std::vector<uint32_t> v_idx, shared_ptr<material> m)
+            : vertices(std::move(verts)), vertex_indices(std::move(v_idx)), mat_ptr(std::move(m)) {
+        build_bvh();
+    }
+
+    size_t triangle_count() const { return vertex_indices.size() / 3; }
+
+    /**
+     * (Re)build the BVH. Call after filling or changing the vertex and index arrays.
+     */
+    void build_bvh(bvh_build_mode mode = bvh_build_mode::sah);
+
+    /**
+     * Refit the BVH after the vertices moved, e.g. between animation frames.
+     */
+    void refit_bvh();
+
+    virtual bool hit(const ray &r, float t_min, float t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(aabb &output_box) const override;
+
+    /**
+     * @return Approximate heap bytes held by the mesh and its BVH.
+     */
+    size_t memory_usage() const;
+
+public:
+    std::vector<point3> vertices;
+    std::vector<vec3> normals;
+    std::vector<uint32_t> vertex_indices;   // 3 per triangle.
+    std::vector<uint32_t> normal_indices;   // Empty, or 3 per triangle. no_normal for corners without one.
+    shared_ptr<material> mat_ptr;
+    bvh accel;
+
+    static const uint32_t no_normal = UINT32_MAX;
+
+private:
+    /**
+     * Ray transformed into the sheared space of the watertight test, computed once per ray.
+     */
+    struct sheared_ray {
+        int kx, ky, kz;
+        float sx, sy, sz;
+    };
+
+    std::vector<aabb> triangle_boxes() const;
+
+    static sheared_ray shear(const ray &r);
+
+    bool hit_triangle(const ray &r, const sheared_ray &sr, uint32_t tri,
+                      float t_min, float t_max, float &t, float &b1, float &b2) const;
+};
+
+void triangle_mesh::build_bvh(bvh_build_mode mode) {
+    accel.build(triangle_boxes(), mode);
+}
+
+void triangle_mesh::refit_bvh() {
+    accel.refit(triangle_boxes());
+}
+
+std::vector<aabb> triangle_mesh::triangle_boxes() const {
+    std::vector<aabb> boxes(triangle_count());
+#pragma omp parallel for schedule(static) default(none) shared(boxes)
+    for (size_t i = 0; i < boxes.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            boxes[i].expand(vertices[vertex_indices[3 * i + k]]);
+        }
+    }
+    return boxes;
+}
+
+triangle_mesh::sheared_ray triangle_mesh::shear(const ray &r) {
+    sheared_ray sr;
+    vec3 d = r.direction();
+
+    // Permute so that z is the dominant axis of the direction, keeping winding.
+    sr.kz = 0;
+    if (fabs(d.y()) > fabs(d[sr.kz])) sr.kz = 1;
+    if (fabs(d.z()) > fabs(d[sr.kz])) sr.kz = 2;
+    sr.kx = (sr.kz + 1) % 3;
+    sr.ky = (sr.kx + 1) % 3;
+    if (d[sr.kz] < 0) std::swap(sr.kx, sr.ky);
+
+    sr.sx = d[sr.kx] / d[sr.kz];
+    sr.sy = d[sr.ky] / d[sr.kz];
+    sr.sz = 1.0f / d[sr.kz];
+    return sr;
+}
+
+/**
+ * Watertight ray-triangle test (Woop, Benthin and Wald, 2013). Edges shared by two
+ * triangles are tested with identical arithmetic, so rays never slip through.
+ * @param t Hit distance.
+ * @param b1 Barycentric weight of the second vertex.
+ * @param b2 Barycentric weight of the third vertex.
+ */
+bool triangle_mesh::hit_triangle(const ray &r, const sheared_ray &sr, uint32_t tri,
+                                 float t_min, float t_max, float &t, float &b1, float &b2) const {
+    const point3 a = vertices[vertex_indices[3 * tri]] - r.origin();
+    const point3 b = vertices[vertex_indices[3 * tri + 1]] - r.origin();
+    const point3 c = vertices[vertex_indices[3 * tri + 2]] - r.origin();
+
+    const float ax = a[sr.kx] - sr.sx * a[sr.kz];
+    const float ay = a[sr.ky] - sr.sy * a[sr.kz];
+    const float bx = b[sr.kx] - sr.sx * b[sr.kz];
+    const float by = b[sr.ky] - sr.sy * b[sr.kz];
+    const float cx = c[sr.kx] - sr.sx * c[sr.kz];
+    const float cy = c[sr.ky] - sr.sy * c[sr.kz];
+
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+
+    // Fall back to double precision right on an edge.
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = float(double(cx) * double(by) - double(cy) * double(bx));
+        v = float(double(ax) * double(cy) - double(ay) * double(cx));
+        w = float(double(bx) * double(ay) - double(by) * double(ax));
+    }
+
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+        return false;
+
+    const float det = u + v + w;
+    if (det == 0.0f)
+        return false;
+
+    const float az = sr.sz * a[sr.kz];
+    const float bz = sr.sz * b[sr.kz];
+    const float cz = sr.sz * c[sr.kz];
+    const float inv_det = 1.0f / det;
+    t = (u * az + v * bz + w * cz) * inv_det;
+    if (t < t_min || t > t_max)
+        return false;
+
+    b1 = v * inv_det;
+    b2 = w * inv_det;
+    return true;
+}
+
+bool triangle_mesh::hit(const ray &r, float t_min, float t_max, hit_record &rec) const {
+    const sheared_ray sr = shear(r);
+    uint32_t hit_tri = 0;
+    float hit_t = 0, hit_b1 = 0, hit_b2 = 0;
+
+    bool hit_any = accel.traverse(r, t_min, t_max, [&](uint32_t tri, float &closest_so_far) {
+        float t, b1, b2;
+        if (!hit_triangle(r, sr, tri, t_min, closest_so_far, t, b1, b2))
+            return false;
+        closest_so_far = t;
+        hit_t = t;
+        hit_tri = tri;
+        hit_b1 = b1;
+        hit_b2 = b2;
+        return true;
+    });
+    if (!hit_any) return false;
+
+    // Hit record is only filled in for the closest triangle.
+    const point3 &p0 = vertices[vertex_indices[3 * hit_tri]];
+    const point3 &p1 = vertices[vertex_indices[3 * hit_tri + 1]];
+    const point3 &p2 = vertices[vertex_indices[3 * hit_tri + 2]];
+
+    rec.t = hit_t;
+    rec.p = r.at(rec.t);
+    rec.set_face_norm(r, unit_vec(cross(p1 - p0, p2 - p0)));
+    rec.mat_ptr = mat_ptr;
+
+    if (!normal_indices.empty()) {
+        uint32_t n0 = normal_indices[3 * hit_tri];
+        uint32_t n1 = normal_indices[3 * hit_tri + 1];
+        uint32_t n2 = normal_indices[3 * hit_tri + 2];
+        if (n0 != no_normal && n1 != no_normal && n2 != no_normal) {
+            // Interpolated shading normal, kept on the same side as the geometric one.
+            vec3 n = unit_vec((1 - hit_b1 - hit_b2) * normals[n0] + hit_b1 * normals[n1] + hit_b2 * normals[n2]);
+            rec.norm = dot(n, rec.norm) < 0 ? -n : n;
+        }
+    }
+    return true;
+}
+
+bool triangle_mesh::bounding_box(aabb &output_box) const {
+    return accel.bounding_box(output_box);
+}
+
+size_t triangle_mesh::memory_usage() const {
+    return vertices.capacity() * sizeof(point3)
+           + normals.capacity() * sizeof(vec3)
+           + vertex_indices.capacity() * sizeof(uint32_t)
+           + normal_indices.capacity() * sizeof(uint32_t)
+           + accel.nodes.capacity() * sizeof(bvh_flat_node)
+           + accel.prim_indices.capacity() * sizeof(uint32_t);
+}
+
+#endif //RAYTRACER_TRIANGLE_MESH_H